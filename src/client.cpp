@@ -15,6 +15,7 @@
 
 #include "tlm_payload.h" // For the C++ struct
 #include "stats.h"
+#include "low_latency.h"
 
 // --- Unix Socket Helpers ---
 bool read_all(int fd, void* buf, size_t size) {
@@ -99,24 +100,41 @@ zmq::message_t build_direct_message(uint64_t id, const std::vector<uint8_t>& pay
 int main (int argc, char* argv[])
 {
     if (argc < 3) {
-        std::cerr << "Usage: " << argv[0] << " <mode> <size_kb> [num_requests]" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <mode> <size_kb> [num_requests] [profile] [spin_us]" << std::endl;
         std::cerr << "  mode: capnp-packed, capnp-flat, direct, or direct-unix" << std::endl;
         std::cerr << "  size_kb: 4 or 4096" << std::endl;
+        std::cerr << "  profile: blocking (default), busy-poll, or busy-poll-rt" << std::endl;
+        std::cerr << "  spin_us: spin budget before blocking, default " << kDefaultSpinUs << ", -1 spins forever" << std::endl;
         return 1;
     }
 
     std::string mode = argv[1];
     size_t payload_size = std::stoul(argv[2]) * 1024;
     int num_requests = (argc > 3) ? std::stoi(argv[3]) : 1000;
+    std::string profile_name = (argc > 4) ? argv[4] : "blocking";
+    long spin_us = (argc > 5) ? std::stol(argv[5]) : kDefaultSpinUs;
 
     if ((mode != "capnp-packed" && mode != "capnp-flat" && mode != "direct" && mode != "direct-unix") || (payload_size != 4096 && payload_size != 4096 * 1024)) {
         std::cerr << "Invalid arguments. Mode must be one of 'capnp-packed', 'capnp-flat', 'direct', 'direct-unix'." << std::endl;
         return 1;
     }
 
+    LatencyProfile profile;
+    if (!parse_latency_profile(profile_name, spin_us, profile)) {
+        std::cerr << "Invalid profile. Must be one of 'blocking', 'busy-poll', 'busy-poll-rt'." << std::endl;
+        return 1;
+    }
+
     //  Prepare our context and socket
     zmq::context_t context (1);
+    if (profile.busy_poll && mode != "direct-unix" && !isolate_zmq_io_thread(context)) {
+        std::cerr << "Warning: ZMQ busy-poll spinning disabled." << std::endl;
+        profile.spin_us = 0;
+    }
     zmq::socket_t socket (context, ZMQ_REQ);
+    if (profile.realtime) {
+        apply_realtime_tuning();
+    }
     int client_fd = -1;
     const char* socket_path = "/tmp/capnproto-test.sock";
 
@@ -135,6 +153,9 @@ int main (int argc, char* argv[])
         if (setsockopt(client_fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size)) < 0) {
             perror("setsockopt SO_RCVBUF failed");
         }
+        if (profile.busy_poll) {
+            set_busy_poll(client_fd, kSocketBusyPollUs);
+        }
 
         address.sun_family = AF_UNIX;
         strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
@@ -183,6 +204,12 @@ int main (int argc, char* argv[])
     Stats ser_copy_stats;
     
     std::cout << "Running test: mode=" << mode << ", payload=" << payload_size / 1024 << "KB, requests=" << num_requests << std::endl;
+    print_latency_profile(profile);
+
+    auto read_message = [&](void* buf, size_t size) {
+        return profile.busy_poll ? read_all_hybrid(client_fd, buf, size, profile.spin_us)
+                                 : read_all(client_fd, buf, size);
+    };
 
     // Pre-allocate and shuffle payload data to avoid this cost in the loop
     std::vector<uint8_t> payload(payload_size);
@@ -193,6 +220,9 @@ int main (int argc, char* argv[])
     std::shuffle(payload.begin(), payload.end(), g_main);
 
     //  Do N requests, waiting each time for a response
+    CpuUsage cpu_usage;
+    double rtt_cpu_us = 0; // CPU spent in send/receive only, excluding serialization
+    int completed_requests = 0;
     for (int request_nbr = 0; request_nbr != num_requests; request_nbr++) {
         zmq::message_t request;
         
@@ -233,6 +263,7 @@ int main (int argc, char* argv[])
             ser_total_stats.add(total_duration_us);
         }
         
+        double rtt_cpu_start_us = CpuUsage::process_cpu_us();
         auto rtt_start = std::chrono::high_resolution_clock::now();
 
         if (mode == "direct-unix") {
@@ -243,7 +274,7 @@ int main (int argc, char* argv[])
             }
 
             uint32_t reply_size;
-            if (!read_all(client_fd, &reply_size, sizeof(reply_size))) {
+            if (!read_message(&reply_size, sizeof(reply_size))) {
                 std::cerr << "Error reading reply size from server." << std::endl;
                 break;
             }
@@ -256,7 +287,7 @@ int main (int argc, char* argv[])
             // We need a buffer to read the reply into, but we don't actually use the data.
             // Let's reuse the zmq::message_t as a buffer to avoid another large allocation.
             request.rebuild(reply_size);
-            if (!read_all(client_fd, request.data(), reply_size)) {
+            if (!read_message(request.data(), reply_size)) {
                 std::cerr << "Error reading reply payload from server." << std::endl;
                 break;
             }
@@ -265,13 +296,20 @@ int main (int argc, char* argv[])
             socket.send (request, zmq::send_flags::none);
             //  Get the reply.
             zmq::message_t reply;
-            (void)socket.recv (reply, zmq::recv_flags::none);
+            if (profile.busy_poll) {
+                (void)zmq_recv_hybrid(socket, reply, profile.spin_us);
+            } else {
+                (void)socket.recv (reply, zmq::recv_flags::none);
+            }
         }
 
         auto rtt_end = std::chrono::high_resolution_clock::now();
         double rtt_duration_us = std::chrono::duration_cast<std::chrono::microseconds>(rtt_end - rtt_start).count();
         rtt_stats.add(rtt_duration_us);
+        rtt_cpu_us += CpuUsage::process_cpu_us() - rtt_cpu_start_us;
+        completed_requests++;
     }
+    cpu_usage.stop();
 
     std::cout << "\n--- Total Serialization Stats (includes all steps below) ---" << std::endl;
     ser_total_stats.calculate();
@@ -285,6 +323,19 @@ int main (int argc, char* argv[])
     std::cout << "\n--- Network RTT + Deserialization Stats ---" << std::endl;
     rtt_stats.calculate();
 
+    std::cout << "\n--- CPU Usage (profile=" << profile.name << ") ---" << std::endl;
+    cpu_usage.report(completed_requests);
+    double rtt_cpu_per_req = completed_requests > 0 ? rtt_cpu_us / completed_requests : 0;
+    std::cout << "CPU per request (send/receive only): " << rtt_cpu_per_req << " us" << std::endl;
+
+    // One line per run so blocking and busy-poll runs can be compared directly.
+    std::cout << "\nProfile summary: profile=" << profile.name
+              << " p50=" << rtt_stats.percentile(0.50) << "us"
+              << " p99=" << rtt_stats.percentile(0.99) << "us"
+              << " p99.9=" << rtt_stats.percentile(0.999) << "us"
+              << " rtt_cpu_per_req=" << rtt_cpu_per_req << "us"
+              << " total_cpu_per_req=" << cpu_usage.cpu_us_per_request(completed_requests) << "us" << std::endl;
+
     if (client_fd != -1) {
         close(client_fd);
     }
@@ -0,0 +1,224 @@
+#ifndef PERF_LOW_LATENCY_H
+#define PERF_LOW_LATENCY_H
+
+#include <zmq.hpp>
+#include <string>
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cerrno>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+// Receive-side latency profiles shared by server and client.
+//
+//   blocking     : default, every receive sleeps in the kernel until data arrives.
+//   busy-poll    : spin on non-blocking receives (ZMQ_DONTWAIT / MSG_DONTWAIT) for
+//                  up to spin_us microseconds, then fall back to a blocking receive.
+//   busy-poll-rt : busy-poll plus mlockall() and SCHED_FIFO on the main thread
+//                  (needs CAP_SYS_NICE and CAP_IPC_LOCK or a suitable rlimit;
+//                  failures are reported and the run continues without them).
+//
+// A negative spin_us spins forever and never blocks.
+//
+// In the ZMQ modes the message is delivered by libzmq's I/O thread, so the
+// spinning main thread must not share a core with it; see isolate_zmq_io_thread().
+struct LatencyProfile {
+    std::string name = "blocking";
+    bool busy_poll = false;
+    bool realtime = false;
+    long spin_us = 0;
+};
+
+const long kDefaultSpinUs = 200;
+const int kSocketBusyPollUs = 50;
+
+inline bool parse_latency_profile(const std::string& name, long spin_us, LatencyProfile& profile) {
+    if (name == "blocking") {
+        profile = LatencyProfile();
+        return true;
+    }
+    if (name != "busy-poll" && name != "busy-poll-rt") {
+        return false;
+    }
+    profile.name = name;
+    profile.busy_poll = true;
+    profile.realtime = (name == "busy-poll-rt");
+    profile.spin_us = spin_us;
+    return true;
+}
+
+inline void print_latency_profile(const LatencyProfile& profile) {
+    std::cout << "Latency profile: " << profile.name;
+    if (profile.busy_poll) {
+        if (profile.spin_us < 0) {
+            std::cout << " (spin forever)";
+        } else {
+            std::cout << " (spin " << profile.spin_us << " us, then block)";
+        }
+    }
+    std::cout << std::endl;
+}
+
+// Lock all pages and switch the calling thread (only) to SCHED_FIFO. Threads
+// created afterwards inherit the policy, so in the ZMQ modes call this after
+// the first socket exists, i.e. after libzmq has started its I/O thread.
+inline void apply_realtime_tuning() {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        perror("mlockall failed");
+    }
+
+    // Mid-range priority: above normal tasks, below kernel threads such as
+    // migration/watchdog that run at the maximum.
+    struct sched_param param;
+    param.sched_priority = 50;
+    int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (rc != 0) {
+        errno = rc;
+        perror("pthread_setschedparam SCHED_FIFO failed");
+    }
+}
+
+// Split the CPUs the user gave this process with taskset: the main thread
+// keeps the first one and libzmq's I/O thread gets the rest. Must be called
+// before the first socket is created, since that is when libzmq starts the
+// I/O thread. Returns false (after saying why) if the CPUs cannot be split
+// safely, in which case the caller should not spin.
+inline bool isolate_zmq_io_thread(zmq::context_t& context) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        perror("sched_getaffinity failed");
+        return false;
+    }
+    int allowed_count = CPU_COUNT(&allowed);
+    if (allowed_count < 2) {
+        std::cerr << "Only one CPU available; the spinning main thread would starve the ZMQ I/O thread." << std::endl;
+        return false;
+    }
+    // With the full mask, server and client would both claim the lowest CPU
+    // for their spinning main threads, so require an explicit choice.
+    if (allowed_count >= sysconf(_SC_NPROCESSORS_ONLN)) {
+        std::cerr << "CPU affinity not narrowed; pin each process to two dedicated CPUs with taskset (e.g. taskset -c 0,2)." << std::endl;
+        return false;
+    }
+
+#ifdef ZMQ_THREAD_AFFINITY_CPU_ADD
+    int main_cpu = -1;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed)) {
+            continue;
+        }
+        if (main_cpu < 0) {
+            main_cpu = cpu;
+        } else if (zmq_ctx_set(context.handle(), ZMQ_THREAD_AFFINITY_CPU_ADD, cpu) < 0) {
+            perror("zmq_ctx_set ZMQ_THREAD_AFFINITY_CPU_ADD failed");
+            return false;
+        }
+    }
+
+    cpu_set_t main_set;
+    CPU_ZERO(&main_set);
+    CPU_SET(main_cpu, &main_set);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(main_set), &main_set);
+    if (rc != 0) {
+        errno = rc;
+        perror("pthread_setaffinity_np failed");
+        return false;
+    }
+    std::cout << "Main thread on CPU " << main_cpu << ", ZMQ I/O thread on the remaining CPUs." << std::endl;
+    return true;
+#else
+    // Older libzmq cannot pin its I/O thread, so it may share the main thread's core.
+    (void)context;
+    std::cerr << "This libzmq lacks ZMQ_THREAD_AFFINITY_CPU_ADD; cannot keep the I/O thread off the main thread's core." << std::endl;
+    return false;
+#endif
+}
+
+// SO_BUSY_POLL only takes effect on NAPI-backed sockets; on AF_UNIX it is
+// accepted but the MSG_DONTWAIT spin in read_all_hybrid does the real work.
+inline void set_busy_poll(int fd, int busy_poll_us) {
+#ifdef SO_BUSY_POLL
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_us, sizeof(busy_poll_us)) < 0) {
+        perror("setsockopt SO_BUSY_POLL failed");
+    }
+#else
+    (void)fd;
+    (void)busy_poll_us;
+#endif
+}
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+inline bool spin_budget_left(std::chrono::steady_clock::time_point spin_start, long spin_us) {
+    if (spin_us < 0) {
+        return true;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - spin_start;
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() < spin_us;
+}
+
+inline double elapsed_us(std::chrono::steady_clock::time_point start) {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::micro>(elapsed).count();
+}
+
+// Spin-then-block ZMQ receive. Returns false if no message was received.
+// If blocked_us is given, it receives the time spent in the blocking fallback.
+inline bool zmq_recv_hybrid(zmq::socket_t& socket, zmq::message_t& msg, long spin_us,
+                            double* blocked_us = nullptr) {
+    auto spin_start = std::chrono::steady_clock::now();
+    while (spin_budget_left(spin_start, spin_us)) {
+        if (socket.recv(msg, zmq::recv_flags::dontwait)) {
+            return true;
+        }
+        cpu_relax();
+    }
+    auto block_start = std::chrono::steady_clock::now();
+    bool received = socket.recv(msg, zmq::recv_flags::none).has_value();
+    if (blocked_us) {
+        *blocked_us = elapsed_us(block_start);
+    }
+    return received;
+}
+
+// Spin-then-block counterpart of read_all(). The spin budget restarts whenever
+// bytes arrive, so a large message streaming in pieces keeps spinning.
+// If blocked_us is given, the time spent in blocking recv() calls is added to it.
+inline bool read_all_hybrid(int fd, void* buf, size_t size, long spin_us,
+                            double* blocked_us = nullptr) {
+    char* p = static_cast<char*>(buf);
+    size_t remaining = size;
+    auto spin_start = std::chrono::steady_clock::now();
+    while (remaining > 0) {
+        int flags = spin_budget_left(spin_start, spin_us) ? MSG_DONTWAIT : 0;
+        auto recv_start = std::chrono::steady_clock::now();
+        ssize_t bytes_read = recv(fd, p, remaining, flags);
+        if (flags == 0 && blocked_us) {
+            *blocked_us += elapsed_us(recv_start);
+        }
+        if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            cpu_relax();
+            continue;
+        }
+        if (bytes_read <= 0) {
+            return false; // Error or peer disconnected
+        }
+        p += bytes_read;
+        remaining -= bytes_read;
+        spin_start = std::chrono::steady_clock::now();
+    }
+    return true;
+}
+
+#endif // PERF_LOW_LATENCY_H
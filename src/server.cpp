@@ -16,6 +16,7 @@
 
 #include "tlm_payload.h" // For the C++ struct
 #include "stats.h"
+#include "low_latency.h"
 
 // --- Global stats object and signal handler ---
 Stats deserialization_stats;
@@ -121,26 +122,42 @@ bool write_all(int fd, const void* buf, size_t size) {
 
 int main (int argc, char* argv[]) {
     if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <mode> [print_interval]" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <mode> [print_interval] [profile] [spin_us]" << std::endl;
         std::cerr << "  mode: capnp-packed, capnp-flat, direct, or direct-unix" << std::endl;
+        std::cerr << "  profile: blocking (default), busy-poll, or busy-poll-rt" << std::endl;
+        std::cerr << "  spin_us: spin budget before blocking, default " << kDefaultSpinUs << ", -1 spins forever" << std::endl;
         return 1;
     }
     std::string mode = argv[1];
     int print_interval = (argc > 2) ? std::stoi(argv[2]) : 1000;
+    std::string profile_name = (argc > 3) ? argv[3] : "blocking";
+    long spin_us = (argc > 4) ? std::stol(argv[4]) : kDefaultSpinUs;
 
     if (mode != "capnp-packed" && mode != "capnp-flat" && mode != "direct" && mode != "direct-unix") {
         std::cerr << "Invalid mode specified." << std::endl;
         return 1;
     }
 
+    LatencyProfile profile;
+    if (!parse_latency_profile(profile_name, spin_us, profile)) {
+        std::cerr << "Invalid profile specified." << std::endl;
+        return 1;
+    }
+
     Stats stats;
+    CpuUsage cpu_usage;
     int request_count = 0;
     const char* socket_path = "/tmp/capnproto-test.sock";
 
     std::cout << "Server starting in " << mode << " mode. Printing stats every " << print_interval << " requests." << std::endl;
+    print_latency_profile(profile);
     std::cout << "(Press Ctrl+C to stop the server)" << std::endl;
 
     if (mode == "direct-unix") {
+        if (profile.realtime) {
+            apply_realtime_tuning();
+        }
+
         int server_fd, client_fd;
         struct sockaddr_un address;
         
@@ -184,22 +201,46 @@ int main (int argc, char* argv[]) {
         if (setsockopt(client_fd, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size)) < 0) {
             perror("setsockopt SO_SNDBUF failed");
         }
+        if (profile.busy_poll) {
+            set_busy_poll(client_fd, kSocketBusyPollUs);
+        }
+
+        auto read_message = [&](void* buf, size_t size, double* blocked_us = nullptr) {
+            if (profile.busy_poll) {
+                return read_all_hybrid(client_fd, buf, size, profile.spin_us, blocked_us);
+            }
+            auto read_start = std::chrono::steady_clock::now();
+            bool ok = read_all(client_fd, buf, size);
+            if (blocked_us) {
+                *blocked_us += elapsed_us(read_start);
+            }
+            return ok;
+        };
 
         std::vector<char> buffer(8 * 1024 * 1024); // 8MB buffer, should be large enough
         
         while(true) {
+            // The CPU window opens before a batch's first receive so its spin
+            // is counted; only the blocking wait for it is left out of wall time.
+            if (request_count == 0) {
+                cpu_usage.reset();
+            }
             uint32_t msg_size;
-            if (!read_all(client_fd, &msg_size, sizeof(msg_size))) {
+            double blocked_us = 0;
+            if (!read_message(&msg_size, sizeof(msg_size), &blocked_us)) {
                 std::cout << "Client disconnected while reading size." << std::endl;
                 break;
             }
+            if (request_count == 0) {
+                cpu_usage.exclude_wall(blocked_us);
+            }
 
             if (msg_size > buffer.size()) {
                 std::cerr << "Error: Message size " << msg_size << " is larger than buffer " << buffer.size() << std::endl;
                 break;
             }
 
-            if (!read_all(client_fd, buffer.data(), msg_size)) {
+            if (!read_message(buffer.data(), msg_size)) {
                 std::cout << "Client disconnected while reading payload." << std::endl;
                 break;
             }
@@ -216,12 +257,22 @@ int main (int argc, char* argv[]) {
             if (request_count == print_interval) {
                 std::cout << "\n--- Server Deserialization Stats (last " << print_interval << " requests) ---" << std::endl;
                 stats.calculate();
+                cpu_usage.report(request_count);
                 stats = Stats();
                 request_count = 0;
             }
         }
         close(client_fd); // Close the connection to this specific client
         std::cout << "Client connection closed." << std::endl;
+
+        // Flush a partial batch so stats and CPU never span two clients.
+        if (request_count > 0) {
+            std::cout << "\n--- Server Deserialization Stats (last " << request_count << " requests, client disconnected) ---" << std::endl;
+            stats.calculate();
+            cpu_usage.report(request_count);
+            stats = Stats();
+            request_count = 0;
+        }
         } // End of main accept loop
 
         // The following lines are now theoretically unreachable unless the server is stopped with a signal
@@ -233,12 +284,33 @@ int main (int argc, char* argv[]) {
 
     // ZMQ modes
     zmq::context_t context (1);
+    if (profile.busy_poll && !isolate_zmq_io_thread(context)) {
+        std::cerr << "Warning: ZMQ busy-poll spinning disabled." << std::endl;
+        profile.spin_us = 0;
+    }
     zmq::socket_t socket (context, ZMQ_REP);
     socket.bind ("tcp://*:5555");
+    if (profile.realtime) {
+        apply_realtime_tuning();
+    }
 
     while (true) {
+        // Same batch windowing as the direct-unix loop above.
+        if (request_count == 0) {
+            cpu_usage.reset();
+        }
         zmq::message_t request;
-        (void)socket.recv (request, zmq::recv_flags::none);
+        double blocked_us = 0;
+        if (profile.busy_poll) {
+            (void)zmq_recv_hybrid(socket, request, profile.spin_us, &blocked_us);
+        } else {
+            auto recv_start = std::chrono::steady_clock::now();
+            (void)socket.recv (request, zmq::recv_flags::none);
+            blocked_us = elapsed_us(recv_start);
+        }
+        if (request_count == 0) {
+            cpu_usage.exclude_wall(blocked_us);
+        }
 
         if (mode == "direct") {
             handle_direct_message(request, stats);
@@ -254,6 +326,7 @@ int main (int argc, char* argv[]) {
         if (request_count == print_interval) {
             std::cout << "\n--- Server Deserialization Stats (last " << print_interval << " requests) ---" << std::endl;
             stats.calculate();
+            cpu_usage.report(request_count);
             // Reset for next batch
             stats = Stats();
             request_count = 0;
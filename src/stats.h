@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <iostream>
 #include <iomanip>
+#include <ctime>
 
 class Stats {
 public:
@@ -32,21 +33,99 @@ public:
             median = latencies_us[mid];
         }
 
-        size_t p99_index = static_cast<size_t>(latencies_us.size() * 0.99);
-        if (p99_index >= latencies_us.size()) {
-            p99_index = latencies_us.size() - 1;
-        }
-        double p99 = latencies_us[p99_index];
+        double p99 = percentile_sorted(0.99);
+        double p999 = percentile_sorted(0.999);
 
         std::cout << std::fixed << std::setprecision(2);
         std::cout << "Samples: " << latencies_us.size() << std::endl;
         std::cout << "Average: " << avg << " us" << std::endl;
         std::cout << "Median (50th): " << median << " us" << std::endl;
         std::cout << "99th Percentile: " << p99 << " us" << std::endl;
+        std::cout << "99.9th Percentile: " << p999 << " us" << std::endl;
+        std::cout << "Max: " << latencies_us.back() << " us" << std::endl;
+    }
+
+    // Returns the given percentile (0.0 - 1.0), or 0 if there is no data.
+    double percentile(double fraction) {
+        if (latencies_us.empty()) {
+            return 0;
+        }
+        std::sort(latencies_us.begin(), latencies_us.end());
+        return percentile_sorted(fraction);
     }
 
 private:
+    double percentile_sorted(double fraction) const {
+        size_t index = static_cast<size_t>(latencies_us.size() * fraction);
+        if (index >= latencies_us.size()) {
+            index = latencies_us.size() - 1;
+        }
+        return latencies_us[index];
+    }
+
     std::vector<double> latencies_us;
 };
 
+// Process CPU time (all threads, including the ZMQ I/O thread) versus wall
+// time over an interval. Busy-polling trades CPU for latency, so this is
+// reported next to the latency percentiles to compare profiles.
+class CpuUsage {
+public:
+    CpuUsage() { reset(); }
+
+    void reset() {
+        wall_start_us = now_us(CLOCK_MONOTONIC);
+        cpu_start_us = now_us(CLOCK_PROCESS_CPUTIME_ID);
+        stopped = false;
+    }
+
+    // Drops time spent asleep in a blocking receive (no CPU used) from the
+    // wall-clock window, e.g. the wait for the first request of a batch.
+    void exclude_wall(double us) {
+        wall_start_us += us;
+    }
+
+    // Freezes the interval so every figure printed afterwards agrees.
+    void stop() {
+        wall_us = now_us(CLOCK_MONOTONIC) - wall_start_us;
+        cpu_us = now_us(CLOCK_PROCESS_CPUTIME_ID) - cpu_start_us;
+        stopped = true;
+    }
+
+    // Only valid after stop().
+    double cpu_us_per_request(size_t requests) const {
+        return requests > 0 ? cpu_us / requests : 0;
+    }
+
+    void report(size_t requests) {
+        if (!stopped) {
+            stop();
+        }
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << "CPU time: " << cpu_us / 1000.0 << " ms over " << wall_us / 1000.0 << " ms wall ("
+                  << (wall_us > 0 ? 100.0 * cpu_us / wall_us : 0.0) << "% of one core)" << std::endl;
+        if (requests > 0) {
+            std::cout << "CPU per request: " << cpu_us_per_request(requests) << " us" << std::endl;
+        }
+    }
+
+    // Raw process CPU clock, for accumulating CPU over a sub-region of a loop.
+    static double process_cpu_us() {
+        return now_us(CLOCK_PROCESS_CPUTIME_ID);
+    }
+
+private:
+    static double now_us(clockid_t clock) {
+        struct timespec ts;
+        clock_gettime(clock, &ts);
+        return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+    }
+
+    double wall_start_us;
+    double cpu_start_us;
+    double wall_us = 0;
+    double cpu_us = 0;
+    bool stopped = false;
+};
+
 #endif // PERF_STATS_H
\ No newline at end of file